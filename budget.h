@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+
+#include "options.h"
+
+// Anytime mode : a search stops after maxNodes calls or maxSeconds seconds, 0 meaning
+// no limit. Limits are only looked at every period calls, so reading the clock stays
+// off the hot path and --max-nodes may overshoot by less than period.
+struct Budget {
+    static constexpr long long period = 1 << 12;
+    long long maxNodes = 0;
+    double maxSeconds = 0;
+    std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+    // --max-nodes N and --max-seconds S
+    void read(const Options& options) {
+        if(options.get("max-nodes")) maxNodes = std::atoll(options.get("max-nodes"));
+        if(options.get("max-seconds")) maxSeconds = std::atof(options.get("max-seconds"));
+    }
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+    }
+
+    bool exhausted(long long calls) const {
+        if(calls % period != 0) return false;
+        return (maxNodes > 0 && calls >= maxNodes) || (maxSeconds > 0 && seconds() >= maxSeconds);
+    }
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Reads a deck with one card per line, as whitespace separated integers.
+// Empty lines and lines starting with '#' are skipped.
+inline bool readDeck(const std::string& path, std::vector<std::vector<int>>& deck) {
+    std::ifstream in(path);
+    if(!in) return false;
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::vector<int> card;
+        int id;
+        while(ss >> id) card.push_back(id);
+        if(!ss.eof()) return false;
+        if(!card.empty()) deck.push_back(card);
+    }
+    return true;
+}
+
+// Writes decks in the format readDeck expects. Logo ids are formatted straight into a
+// fixed buffer which is handed to an unbuffered FILE, so nothing is copied in between.
+// The file is only created by the first flush holding data, so a run that writes
+// nothing leaves no empty deck behind ; ok() turns false if it cannot be created.
+struct DeckWriter {
+    static constexpr int capacity = 1 << 16;
+    std::array<char, capacity> buffer;
+    int size;
+    bool lineStart;
+    std::string path;
+    std::FILE* out;
+    bool failed;
+    long long cards;
+
+    explicit DeckWriter(const std::string& path) : size(0), lineStart(true), path(path), out(nullptr), failed(false), cards(0) {}
+
+    ~DeckWriter() {
+        flush();
+        if(out) std::fclose(out);
+    }
+
+    DeckWriter(const DeckWriter&) = delete;
+    DeckWriter& operator=(const DeckWriter&) = delete;
+
+    bool ok() const { return !failed; }
+
+    void flush() {
+        if(size > 0 && !out && !failed) {
+            out = std::fopen(path.c_str(), "w");
+            failed = !out;
+            if(out) std::setvbuf(out, nullptr, _IONBF, 0);
+        }
+        if(out && size > 0) std::fwrite(buffer.data(), 1, size, out);
+        size = 0;
+    }
+
+    void reserve(int n) {
+        if(size + n > capacity) flush();
+    }
+
+    void symbol(int id) {
+        reserve(16);
+        if(!lineStart) buffer[size++] = ' ';
+        char* end = std::to_chars(buffer.data()+size, buffer.data()+capacity, id).ptr;
+        size = (int)(end - buffer.data());
+        lineStart = false;
+    }
+
+    void endCard() {
+        reserve(1);
+        buffer[size++] = '\n';
+        lineStart = true;
+        ++cards;
+    }
+
+    // comment line, skipped by readDeck
+    void comment(const std::string& text) {
+        reserve((int)text.size()+3);
+        buffer[size++] = '#';
+        buffer[size++] = ' ';
+        for(char c : text) buffer[size++] = c;
+        buffer[size++] = '\n';
+    }
+};
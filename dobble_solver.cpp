@@ -4,9 +4,18 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <bitset>
+#include <climits>
+
+#include "isomorphism.h"
+#include "deck_io.h"
+#include "options.h"
+#include "budget.h"
 
 #define template_header int N, int U=N*(N-1)+1
 
+#define SIBLING_BATCH 1
+
 struct Logo {
     int id;
 
@@ -24,12 +33,13 @@ struct Logo {
 template<template_header>
 struct Card {
 
-    Card() : logos(), active(), nz(0) {
+    Card() : logos(), active(), mask(), nz(0) {
         std::fill(active.begin(), active.end(), 0);
     }
 
     std::array<Logo, N> logos;
     std::array<int, U> active;
+    std::bitset<U> mask;
     int nz;
 
 
@@ -52,6 +62,7 @@ struct Card {
         if(id >= U) return false;
         logos[nz] = Logo(id);
         if(id < U) active[id] = 1;
+        if(id < U) mask[id] = 1;
         ++nz;
         return true;
     }
@@ -60,9 +71,27 @@ struct Card {
         logos[nz] = l;
         assert(l.id >= 0 && l.id < U);
         active[l.id] = 1;
+        mask[l.id] = 1;
         ++nz;
     }
 
+    void pop() {
+        assert(nz > 0);
+        active[logos[nz-1].id] = 0;
+        mask[logos[nz-1].id] = 0;
+        --nz;
+    }
+
+    // moves the last logo up to id
+    void jump(int id) {
+        assert(id > logos[nz-1].id && id < U);
+        active[logos[nz-1].id] = 0;
+        mask[logos[nz-1].id] = 0;
+        logos[nz-1] = Logo(id);
+        active[id] = 1;
+        mask[id] = 1;
+    }
+
     bool valid() const {
         return (nz == N) && std::all_of(logos.begin(), logos.begin()+nz, [](const Logo& l){ return l.id < U; });
     }
@@ -70,10 +99,12 @@ struct Card {
     bool next() {
         assert(logos[nz-1].id >= 0 && logos[nz-1].id < U);
         active[logos[nz-1].id] = 0;
+        mask[logos[nz-1].id] = 0;
         logos[nz-1].next();
         bool ok = (logos[nz-1].id < U);
         if(ok) {
             active[logos[nz-1].id] = 1;
+            mask[logos[nz-1].id] = 1;
         }
         return ok;
     }
@@ -112,16 +143,20 @@ template<template_header>
 struct Solution {
     std::vector<Card<N,U>> cards;
     bool nil;
+    // logos placed on all cards, kept up to date by push
+    int placed;
 
-    Solution() : cards(), nil(false) {}
+    Solution() : cards(), nil(false), placed(0) {}
 
     bool violates() const {
         if(nil) return true;
         if(cards.size() > U) return true;
         if(cards.back().logos.size() < N && cards.back().logos.back() == U) return true;
+#if !SIBLING_BATCH
         for(int i = 0; i < cards.size()-1; ++i) {
             if(!cards.back().compatibleWith(cards[i])) return true;
         }
+#endif
         return false;
     }
 
@@ -147,6 +182,8 @@ struct Solution {
         }
         if(!cards.back().push()) {
             nil = true;
+        } else {
+            ++placed;
         }
     }
 
@@ -156,10 +193,49 @@ struct Solution {
         }
     }
 
+#if SIBLING_BATCH
+    // logos the next push can take : its range minus every earlier card sharing a logo with it
+    std::bitset<U> siblings(long long& filtered) const {
+        bool fresh = (cards.back().nz == N);
+        int nz = (fresh ? 0 : cards.back().nz);
+        int lo = (nz == 0 ? 0 : cards.back().logos[nz-1].id+1);
+        int hi = U-N+nz;
+        std::bitset<U> range = (~std::bitset<U>() << lo) & (~std::bitset<U>() >> (U-1-hi));
+        std::bitset<U> s = range;
+        if(!fresh) {
+            for(size_t i = 0; i+1 < cards.size(); ++i) {
+                if((cards[i].mask & cards.back().mask).any()) s &= ~cards[i].mask;
+            }
+        }
+        filtered += range.count() - s.count();
+        return s;
+    }
+
+    void push(Logo l) {
+        if(cards.back().nz == N) cards.emplace_back();
+        cards.back().push(l);
+        ++placed;
+    }
+
+    void jump(int id) {
+        cards.back().jump(id);
+    }
+#endif
+
     bool isNil() const {
         return nil;
     }
 
+    int height() const {
+        return placed;
+    }
+
+    // recomputes placed after cards were filled directly
+    void recount() {
+        placed = 0;
+        for(const Card<N,U>& c : cards) placed += c.nz;
+    }
+
     std::string toString() const {
         std::string s;
         s += "nil?" + std::to_string(nil) + " ";
@@ -167,6 +243,15 @@ struct Solution {
         for(const Card<N,U>& c : cards) s += c.toString() + '\n';
         return s;
     }
+
+    Graph toGraph() const {
+        std::vector<std::vector<int>> deck;
+        for(const Card<N,U>& c : cards) {
+            deck.emplace_back();
+            for(int i = 0; i < c.nz; ++i) deck.back().push_back(c.logos[i].id);
+        }
+        return Graph::ofDeck(deck, U);
+    }
 };
 
 template<template_header>
@@ -204,10 +289,44 @@ struct Solver {
             }
         }
 
+        r.recount();
         std::cout << "Root : " << r.toString() << "\n";
         return r;
     }
 
+    // Pins the cards of a partial deck (Logo ids, one card per line) instead of the hardcoded root.
+    // Cards are rebuilt logo by logo and checked like the search does, so compatibleWith
+    // only ever sees the last pushed logo as a possible new collision.
+    Solution<N, U> seeded(const std::string& path) {
+        Solution<N, U> r;
+        std::vector<std::vector<int>> deck;
+        if(!readDeck(path, deck) || deck.empty() || deck.size() > U) {
+            std::cout << "Cannot read a partial deck from " << path << "\n";
+            r.nil = true;
+            return r;
+        }
+        for(std::vector<int> ids : deck) {
+            std::sort(ids.begin(), ids.end());
+            r.cards.emplace_back();
+            Card<N, U>& c = r.cards.back();
+            bool ok = (ids.size() == N);
+            for(int i = 0; ok && i < N; ++i) {
+                ok = (ids[i] >= 0 && ids[i] < U && !c.active[ids[i]]);
+                if(!ok) break;
+                c.push(Logo{ids[i]});
+                for(size_t j = 0; ok && j+1 < r.cards.size(); ++j) ok = c.compatibleWith(r.cards[j]);
+            }
+            if(!ok) {
+                std::cout << "Invalid card " << r.cards.size() << " in " << path << "\n";
+                r.nil = true;
+                return r;
+            }
+        }
+        r.recount();
+        std::cout << "Seed : " << r.toString() << "\n";
+        return r;
+    }
+
     bool reject(const Solution<N, U>& sol) {
         return sol.violates();
     }
@@ -227,9 +346,34 @@ struct Solver {
     }
 
     long long calls = 0;
+#if SIBLING_BATCH
+    long long filtered = 0;
+#endif
+    bool enumerate = false;
+    Classifier classifier;
     std::chrono::system_clock::time_point begin;
     std::chrono::system_clock::time_point current;
 
+    Budget budget;
+    int deepestHeight = -1;
+    Solution<N, U> deepest;
+
+    void budgetExhausted() {
+        std::cout << "Budget exhausted" << std::endl;
+        std::cout << deepest.toString() << std::endl;
+        std::cout << "Deepest partial solution : " << deepestHeight << " / " << N*U << "\n";
+#if SIBLING_BATCH
+        std::cout << "Filtered siblings : " << filtered << "\n";
+#endif
+        if(enumerate) {
+            classifier.finish();
+            std::cout << classifier.toString();
+        }
+        std::cout << "Seconds : " << budget.seconds() << "\n";
+        std::cout << "Total calls : " << calls << "\n";
+        std::exit(0);
+    }
+
     void backtrack(Solution<N, U>& candidate) {
         calls++;
         if(calls % 1000000 == 0) {
@@ -239,24 +383,282 @@ struct Solver {
             std::cout 
                 << (calls / 1.0e6) << " Mcalls\n"
                 << (calls / 1.0e6) / (elapsed.count() / 1.0e9) << " Mcalls/s" << '\n'
+                << (enumerate ? std::to_string((long long)classifier.rate()) + " classified/s\n" : "")
+#if SIBLING_BATCH
+                << (filtered / 1.0e6) << " M siblings filtered\n"
+#endif
                 //<< elapsed.count() << " t"
                 << candidate.toString() 
                 << std::endl;    
         }
+        if(budget.exhausted(calls)) {
+            budgetExhausted();
+        }
         if(reject(candidate)) return;
+        int height = candidate.height();
+        if(height > deepestHeight) {
+            deepestHeight = height;
+            deepest = candidate;
+        }
         if(accept(candidate)) {
+            if(enumerate) {
+                classifier.classify(candidate.toGraph(), {}, [candidate](long long cls, long long solution) {
+                    std::cout << "Class " << cls << " (solution " << solution << ")\n";
+                    std::cout << candidate.toString() << std::endl;
+                });
+                return;
+            }
             std::cout << "Solution found" << std::endl;
             std::cout << candidate.toString() << std::endl;
             std::cout << "Total calls : " << calls << "\n";
             std::exit(0);
         }
 
+#if SIBLING_BATCH
+        // U goes past 64 from N = 9 on, so the set bits are walked 64 at a time
+        std::bitset<U> siblings = candidate.siblings(filtered);
+        if(siblings.none()) return;
+        const std::bitset<U> word(~0ULL);
+        Solution<N, U> s = candidate;
+        bool pushed = false;
+        for(int base = 0; base < U; base += 64) {
+            unsigned long long bits = ((siblings >> base) & word).to_ullong();
+            while(bits) {
+                int id = base + __builtin_ctzll(bits);
+                bits &= bits-1;
+                if(pushed) {
+                    s.jump(id);
+                } else {
+                    s.push(Logo{id});
+                    pushed = true;
+                }
+                backtrack(s);
+            }
+        }
+#else
         Solution<N, U> s = first(candidate);
         while(!s.isNil()) {
             backtrack(s);
             next(s);
         }
+#endif
+
+    }
+
+    // Maximum partial decks : branch and bound over complete cards using logos 0..symbols-1.
+    // Cards are added in increasing lexicographic order, the first one being 0..N-1, and each
+    // card is built logo by logo against compatibleWith like seeded() does. A logo can only
+    // go on new cards with partners it has not met yet among the logos still reachable
+    // (those >= the first logo of the last card), N-1 of them per card, which bounds the
+    // number of cards that can still be added.
+    // A deck on fewer logos is still valid with more of them, so the search runs for
+    // symbols = N, N+1, ... up to goal. Each round first tries to add cards to the best
+    // deck so far (or the seed deck) as it stands, the new cards being ordered among
+    // themselves only, fixed being the number of leading cards the order ignores. It then
+    // searches from scratch for a strictly larger deck. Only the last round has to prove
+    // anything, so the earlier ones give up after roundCalls calls.
+    // Cards only have to share at most one logo, so the best deck is only playable if
+    // none of its pairs of cards shares no logo at all.
+    static constexpr long long roundCalls = 1 << 18;
+    long long roundEnd = 0;
+    size_t fixed = 1;
+    int symbols = U;
+    int goal = U;
+    std::vector<Card<N, U>> deck;
+    std::vector<Card<N, U>> best;
+    std::vector<std::array<char, U>> paired;
+    std::array<int, U> degree;
+    int limit = 0;
+    int goalLimit = 0;
+
+    int upperBound(int from) const {
+        int capacity = 0;
+        for(int s = from; s < symbols; ++s) {
+            int free = 0;
+            for(int t = from; t < symbols; ++t) free += (t != s && !paired[s][t]);
+            capacity += free / (N-1);
+        }
+        int k = (int)deck.size();
+        int bound = k + capacity / N;
+
+        // Second moment : a logo already on r cards meets them again, plus the other new
+        // cards it goes on, so the a-th new card on it costs r+a-1 intersections. x more cards
+        // only fit if the cheapest spread of their x*N logos costs at most k*x + x(x-1)/2.
+        std::vector<int> bucket(k+1, 0);
+        for(int s = from; s < symbols; ++s) bucket[degree[s]]++;
+        long long cost = 0;
+        int c = 0;
+        for(int x = 1; k + x <= bound; ++x) {
+            for(int i = 0; i < N; ++i) {
+                while(bucket[c] == 0) ++c;
+                --bucket[c];
+                cost += c;
+                if(c+1 == (int)bucket.size()) bucket.push_back(0);
+                ++bucket[c+1];
+            }
+            if(cost > (long long)k*x + x*(x-1)/2) return k + x - 1;
+        }
+        return bound;
+    }
 
+    void place(const Card<N, U>& c, char on) {
+        for(int i = 0; i < N; ++i) {
+            degree[c.logos[i].id] += (on ? 1 : -1);
+            for(int j = 0; j < N; ++j) {
+                if(i != j) paired[c.logos[i].id][c.logos[j].id] = on;
+            }
+        }
+    }
+
+    std::string deckString(const std::vector<Card<N, U>>& cards) const {
+        std::string s;
+        for(const Card<N, U>& c : cards) {
+            for(int i = 0; i < c.nz; ++i) s += std::to_string(c.logos[i].id) + (i+1 < c.nz ? " " : "\n");
+        }
+        return s;
+    }
+
+    void packReport(const char* reason, const char* deckPath) {
+        std::cout << reason << std::endl;
+        std::cout << deckString(best);
+        std::cout << "Best deck : " << best.size() << " cards on " << goal << " logos, upper bound " << goalLimit
+                  << " (cards sharing at most one logo)\n";
+        int apart = 0;
+        for(size_t i = 0; i < best.size(); ++i) {
+            for(size_t j = i+1; j < best.size(); ++j) apart += !(best[i].mask & best[j].mask).any();
+        }
+        std::cout << "Pairs of cards sharing no logo : " << apart << (apart ? " (not playable)" : " (playable)") << "\n";
+        if(deckPath) {
+            DeckWriter w(deckPath);
+            w.comment(std::to_string(best.size()) + " cards, " + std::to_string(N) + " logos per card, " + std::to_string(goal) + " logos");
+            for(const Card<N, U>& c : best) {
+                for(int i = 0; i < c.nz; ++i) w.symbol(c.logos[i].id);
+                w.endCard();
+            }
+            w.flush();
+            if(!w.ok()) std::cout << "Cannot write deck to " << deckPath << "\n";
+        }
+        std::cout << "Seconds : " << budget.seconds() << "\n";
+        std::cout << "Total calls : " << calls << "\n";
+    }
+
+    void extend(Card<N, U>& c, int from, const char* deckPath) {
+        int rmax = (symbols-1) / (N-1);
+        for(int id = from; id <= symbols - (N - c.nz); ++id) {
+            if((int)best.size() == limit || calls >= roundEnd) return;
+            if(degree[id] == rmax) continue;
+            calls++;
+            if(budget.exhausted(calls)) {
+                packReport("Budget exhausted", deckPath);
+                std::exit(0);
+            }
+            c.push(Logo{id});
+            bool ok = true;
+            for(size_t j = 0; ok && j < deck.size(); ++j) ok = c.compatibleWith(deck[j]);
+            if(ok) {
+                if(c.nz == N) {
+                    deck.push_back(c);
+                    place(c, 1);
+                    pack(deckPath);
+                    place(c, 0);
+                    deck.pop_back();
+                } else {
+                    // same first logo as the last card : the second one has to grow
+                    const Card<N, U>& last = deck.back();
+                    int next = (c.nz == 1 && deck.size() > fixed && id == last.logos[0].id) ? last.logos[1].id+1 : id+1;
+                    extend(c, next, deckPath);
+                }
+            }
+            c.pop();
+        }
+    }
+
+    void pack(const char* deckPath) {
+        if(deck.size() > best.size()) {
+            best = deck;
+            std::cout << "Deck of " << best.size() << " cards after " << calls << " calls" << std::endl;
+        }
+        if((int)best.size() == limit) return;
+        int from = (deck.size() > fixed ? deck.back().logos[0].id : 0);
+        if(upperBound(from) <= (int)best.size()) return;
+        Card<N, U> c;
+        extend(c, from, deckPath);
+    }
+
+    // upper bound on the cards of a deck on the first logos only
+    int rootBound(int logos) {
+        symbols = logos;
+        paired.assign(U, std::array<char, U>());
+        std::fill(degree.begin(), degree.end(), 0);
+        deck.clear();
+        return upperBound(0);
+    }
+
+    // tries to add cards to the best deck as it stands, for roundCalls calls at most
+    void complete(const char* deckPath) {
+        roundEnd = calls + roundCalls;
+        deck = best;
+        for(const Card<N, U>& c : deck) place(c, 1);
+        fixed = deck.size();
+        pack(deckPath);
+        for(const Card<N, U>& c : deck) place(c, 0);
+        fixed = 1;
+        deck.clear();
+    }
+
+    // loads the deck in path as the best one, so the search only looks for a larger one
+    bool seedBest(const std::string& path) {
+        std::vector<std::vector<int>> cards;
+        if(!readDeck(path, cards) || cards.empty()) {
+            std::cout << "Cannot read a deck from " << path << "\n";
+            return false;
+        }
+        best.clear();
+        for(std::vector<int> ids : cards) {
+            std::sort(ids.begin(), ids.end());
+            best.emplace_back();
+            Card<N, U>& c = best.back();
+            bool ok = (ids.size() == N);
+            for(int i = 0; ok && i < N; ++i) {
+                ok = (ids[i] >= 0 && ids[i] < goal && !c.active[ids[i]]);
+                if(!ok) break;
+                c.push(Logo{ids[i]});
+                for(size_t j = 0; ok && j+1 < best.size(); ++j) ok = c.compatibleWith(best[j]);
+            }
+            if(!ok) {
+                std::cout << "Invalid card " << best.size() << " in " << path << "\n";
+                best.clear();
+                return false;
+            }
+        }
+        std::cout << "Seed deck of " << best.size() << " cards" << std::endl;
+        return true;
+    }
+
+    bool maximize(int s, const char* seedPath, const char* deckPath) {
+        goal = s;
+        goalLimit = rootBound(goal);
+        if(seedPath && !seedBest(seedPath)) return false;
+        for(int logos = N; logos <= goal && (int)best.size() < goalLimit; ++logos) {
+            limit = rootBound(logos);
+            if((int)best.size() >= limit) continue;
+            if(!best.empty()) complete(deckPath);
+            if((int)best.size() < limit) {
+                roundEnd = (logos < goal ? calls + roundCalls : LLONG_MAX);
+                deck.emplace_back();
+                for(int i = 0; i < N; ++i) deck.back().push(Logo{i});
+                place(deck.back(), 1);
+                pack(deckPath);
+            }
+            std::cout << logos << " logos : " << best.size() << " cards, upper bound " << limit
+                      << (calls >= roundEnd ? " (round cut)" : "") << std::endl;
+        }
+        if((int)best.size() == goalLimit) {
+            packReport("Upper bound reached", deckPath);
+        } else {
+            packReport("Search exhausted, deck is maximum", deckPath);
+        }
+        return true;
     }
 
     Solver() {
@@ -264,11 +666,52 @@ struct Solver {
     }
 };
 
-int main(int argc, const char* argv[]) {
-    constexpr int N = 6;
+template<int N>
+int run(const std::vector<std::string>& args, const Options& options) {
     Solver<N> s;
-    Solution<N> sol = s.root();
+    s.enumerate = (args.size() >= 2 && std::atoi(args[1].c_str()));
+    s.budget.read(options);
+    if(options.get("max-deck")) {
+        int symbols = std::atoi(options.get("max-deck"));
+        if(symbols < N || symbols > N*(N-1)+1) {
+            std::cout << "--max-deck takes a number of logos between " << N << " and " << N*(N-1)+1 << "\n";
+            return 1;
+        }
+        return s.maximize(symbols, options.get("seed-deck"), options.get("deck")) ? 0 : 1;
+    }
+    Solution<N> sol = (args.size() >= 3 ? s.seeded(args[2]) : s.root());
+    if(sol.isNil()) return 1;
     s.backtrack(sol);
 
+    if(s.enumerate) {
+        s.classifier.finish();
+        std::cout << s.classifier.toString();
+    }
+
     std::cout << "Total calls : " << s.calls << "\n";
-}
\ No newline at end of file
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    Options options(argc, argv);
+    const std::vector<std::string>& args = options.positional;
+    if(args.size() < 1 || args.size() > 3) {
+        std::cout << "Usage : exe N enumerate seedFile [--max-nodes N] [--max-seconds S]\n"
+                  << "        exe N --max-deck logos [--seed-deck deckFile] [--deck deckFile] [--max-nodes N] [--max-seconds S]\n";
+        return 1;
+    }
+    int N = std::atoi(args[0].c_str());
+    switch(N) {
+        case 3: return run<3>(args, options);
+        case 4: return run<4>(args, options);
+        case 5: return run<5>(args, options);
+        case 6: return run<6>(args, options);
+        case 7: return run<7>(args, options);
+        case 8: return run<8>(args, options);
+        case 9: return run<9>(args, options);
+        case 10: return run<10>(args, options);
+        case 11: return run<11>(args, options);
+        case 12: return run<12>(args, options);
+        default: std::cout << "N = " << N << " not supported yet\n"; return 1;
+    }
+}
@@ -0,0 +1,505 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <cstdint>
+#include <climits>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Vertex-coloured graph used to compare solutions up to relabeling.
+// A deck is its card/symbol incidence graph, a set of MOLS is its
+// cell/row/column/symbol graph (see Solution::toGraph in each solver).
+struct Graph {
+    std::vector<int> color;
+    std::vector<std::vector<int>> adj;
+
+    int size() const { return (int)color.size(); }
+
+    int addVertex(int c) {
+        color.push_back(c);
+        adj.emplace_back();
+        return size()-1;
+    }
+
+    void addEdge(int a, int b) {
+        adj[a].push_back(b);
+        adj[b].push_back(a);
+    }
+
+    // cards get colour 0, symbols colour 1
+    static Graph ofDeck(const std::vector<std::vector<int>>& cards, int symbols) {
+        Graph g;
+        for(size_t c = 0; c < cards.size(); ++c) g.addVertex(0);
+        for(int s = 0; s < symbols; ++s) g.addVertex(1);
+        std::vector<int> degree(symbols, 0);
+        for(const std::vector<int>& card : cards) {
+            for(int s : card) degree[s]++;
+        }
+        for(size_t c = 0; c < cards.size(); ++c) g.adj[c].reserve(cards[c].size());
+        for(int s = 0; s < symbols; ++s) g.adj[cards.size()+s].reserve(degree[s]);
+        for(size_t c = 0; c < cards.size(); ++c) {
+            for(int s : cards[c]) g.addEdge((int)c, (int)cards.size()+s);
+        }
+        return g;
+    }
+};
+
+using Certificate = std::vector<int>;
+using Invariant = std::vector<long long>;
+
+template<typename T>
+struct VectorHash {
+    size_t operator()(const std::vector<T>& v) const {
+        uint64_t h = 1469598103934665603ull;
+        for(const T& x : v) {
+            h ^= (uint64_t)x;
+            h *= 1099511628211ull;
+        }
+        return (size_t)h;
+    }
+};
+
+// Canonical labeling by individualization-refinement.
+// A node of the search tree is an ordered partition of the vertices : cells are
+// ordered, and a vertex is coloured by the position its cell starts at, so that
+// refinement only depends on the structure and never on vertex ids. The canonical
+// form is the smallest (node invariants along the path, leaf certificate) over the
+// search tree : nodes whose invariant exceeds the best path are cut, and automorphisms
+// found at the leaves prune children lying in the same stabilizer orbit.
+// A Canonizer keeps its buffers from one graph to the next.
+// Given known, the search stops at the first leaf whose certificate it accepts :
+// equal certificates are equal graphs once relabeled, and on planes the first
+// leaf is nearly always in the orbit of the canonical one.
+struct Canonizer {
+    // lab lists the vertices cell by cell, cell[v] is the position the cell of v starts
+    // at and size[p] the size of the cell starting at p. orbits are the orbits of the
+    // generators fixing the path to the node, folded[depth] generators being merged in.
+    struct Partition {
+        std::vector<int> lab;
+        std::vector<int> cell;
+        std::vector<int> size;
+        int cells;
+        std::vector<int> orbits;
+        size_t folded;
+    };
+
+    const Graph* g = nullptr;
+    int n = 0;
+    Certificate best;
+    std::vector<int> bestLabel;
+    std::vector<int> bestPath;
+    std::vector<uint64_t> bestTrace;
+    std::vector<uint64_t> trace;
+    std::vector<std::vector<int>> generators;
+    std::vector<Partition> levels;
+    long long leaves = 0;
+    size_t backjump = SIZE_MAX;
+    std::function<bool(const Certificate&)> known;
+    bool matched = false;
+
+    // refinement scratch, indexed by vertex or by cell position
+    std::vector<int> count;
+    std::vector<int> histogram;
+    std::vector<int> scratch;
+    std::vector<int> queue;
+    std::vector<int> touched;
+    std::vector<char> queued;
+    std::vector<char> marked;
+    std::vector<int> label;
+    std::vector<int> nbrs;
+    Certificate cert;
+
+    static void mix(uint64_t& h, uint64_t x) {
+        h ^= x;
+        h *= 1099511628211ull;
+    }
+
+    void enqueue(int c) {
+        if(queued[c]) return;
+        queued[c] = 1;
+        queue.push_back(c);
+    }
+
+    // Splits the cells of p until every cell has the same number of neighbours in every
+    // other cell (coarsest equitable partition), starting from the cells in queue.
+    // Each touched cell is counting-sorted by the number of neighbours in the splitter,
+    // and the counts are hashed into inv, which is therefore a node invariant.
+    void refine(Partition& p, uint64_t& inv) {
+        inv = 1469598103934665603ull;
+        for(size_t head = 0; head < queue.size() && p.cells < n; ++head) {
+            int w = queue[head];
+            queued[w] = 0;
+            touched.clear();
+            for(int i = w; i < w + p.size[w]; ++i) {
+                for(int u : g->adj[p.lab[i]]) {
+                    if(count[u]++ == 0 && !marked[p.cell[u]]) {
+                        marked[p.cell[u]] = 1;
+                        touched.push_back(p.cell[u]);
+                    }
+                }
+            }
+            std::sort(touched.begin(), touched.end());
+            mix(inv, w);
+            for(int c : touched) {
+                marked[c] = 0;
+                int k = p.size[c];
+                int low = INT_MAX;
+                int high = 0;
+                for(int i = c; i < c+k; ++i) {
+                    low = std::min(low, count[p.lab[i]]);
+                    high = std::max(high, count[p.lab[i]]);
+                }
+                mix(inv, c);
+                mix(inv, high);
+                if(low == high) {
+                    for(int i = c; i < c+k; ++i) count[p.lab[i]] = 0;
+                    continue;
+                }
+                std::fill(histogram.begin(), histogram.begin() + (high-low+2), 0);
+                for(int i = c; i < c+k; ++i) histogram[count[p.lab[i]] - low + 1]++;
+                for(int x = 1; x <= high-low+1; ++x) histogram[x] += histogram[x-1];
+                for(int i = c; i < c+k; ++i) scratch[c + histogram[count[p.lab[i]] - low]++] = p.lab[i];
+                // histogram[x] now ends the fragment of count low+x
+                bool wasQueued = queued[c];
+                int largest = c;
+                int start = c;
+                for(int x = 0; x <= high-low; ++x) {
+                    int end = c + histogram[x];
+                    if(end == start) continue;
+                    p.size[start] = end - start;
+                    for(int i = start; i < end; ++i) {
+                        p.lab[i] = scratch[i];
+                        p.cell[scratch[i]] = start;
+                        count[scratch[i]] = 0;
+                    }
+                    if(start > c) ++p.cells;
+                    if(p.size[start] > p.size[largest]) largest = start;
+                    mix(inv, end - start);
+                    start = end;
+                }
+                // Hopcroft : a cell already waiting is replaced by all its fragments,
+                // otherwise the largest fragment is implied by the others
+                for(int f = c; f < c+k; f += p.size[f]) {
+                    if(wasQueued || f != largest) enqueue(f);
+                }
+            }
+        }
+        for(int c : queue) queued[c] = 0;
+        queue.clear();
+    }
+
+    // first largest non-singleton cell : on planes it splits far better than the smallest one
+    static int target(const Partition& p) {
+        int t = -1;
+        for(int c = 0; c < (int)p.lab.size(); c += p.size[c]) {
+            if(p.size[c] > 1 && (t < 0 || p.size[c] > p.size[t])) t = c;
+        }
+        return t;
+    }
+
+    // child of parent with v split off the front of its cell
+    void individualize(const Partition& parent, Partition& child, int v) {
+        child.lab = parent.lab;
+        child.cell = parent.cell;
+        child.size = parent.size;
+        child.cells = parent.cells + 1;
+        child.folded = 0;
+        int c = parent.cell[v];
+        int k = parent.size[c];
+        int i = c;
+        while(child.lab[i] != v) ++i;
+        std::swap(child.lab[i], child.lab[c]);
+        child.size[c] = 1;
+        child.size[c+1] = k-1;
+        for(int j = c+1; j < c+k; ++j) child.cell[child.lab[j]] = c+1;
+        enqueue(c);
+    }
+
+    static int find(std::vector<int>& parent, int v) {
+        while(parent[v] != v) v = parent[v] = parent[parent[v]];
+        return v;
+    }
+
+    // merges the generators found since the last call that fix the path to the node
+    void foldOrbits(Partition& p, const std::vector<int>& prefix) {
+        if(p.folded == 0) {
+            p.orbits.resize(n);
+            std::iota(p.orbits.begin(), p.orbits.end(), 0);
+        }
+        for(; p.folded < generators.size(); ++p.folded) {
+            const std::vector<int>& gen = generators[p.folded];
+            bool fixes = std::all_of(prefix.begin(), prefix.end(), [&](int v){ return gen[v] == v; });
+            if(!fixes) continue;
+            for(int v = 0; v < n; ++v) p.orbits[find(p.orbits, v)] = find(p.orbits, gen[v]);
+        }
+    }
+
+    void leaf(const Partition& p, const std::vector<int>& prefix, bool improved) {
+        ++leaves;
+        cert.clear();
+        cert.push_back(n);
+        for(int i = 0; i < n; ++i) {
+            int v = p.lab[i];
+            nbrs.clear();
+            for(int w : g->adj[v]) nbrs.push_back(p.cell[w]);
+            std::sort(nbrs.begin(), nbrs.end());
+            cert.push_back(g->color[v]);
+            cert.push_back((int)nbrs.size());
+            cert.insert(cert.end(), nbrs.begin(), nbrs.end());
+        }
+        if(known && known(cert)) {
+            best.swap(cert);
+            matched = true;
+            return;
+        }
+        if(improved || cert < best) {
+            best.swap(cert);
+            bestLabel = p.lab;
+            bestPath = prefix;
+            bestTrace = trace;
+        } else if(cert == best) {
+            std::vector<int> gen(n);
+            for(int i = 0; i < n; ++i) gen[bestLabel[i]] = p.lab[i];
+            generators.push_back(std::move(gen));
+            // the automorphism maps the subtree holding the best leaf onto the
+            // current one, so the rest of it can be skipped
+            backjump = std::mismatch(prefix.begin(), prefix.end(), bestPath.begin(), bestPath.end()).first - prefix.begin();
+        }
+    }
+
+    // improved : the path so far is already smaller than the best path
+    void search(std::vector<int>& prefix, bool improved) {
+        size_t depth = prefix.size();
+        Partition& p = levels[depth];
+        uint64_t inv;
+        refine(p, inv);
+        if(!improved) {
+            if(inv > bestTrace[depth]) return;
+            improved = (inv < bestTrace[depth]);
+        }
+        trace.push_back(inv);
+        if(p.cells == n) {
+            leaf(p, prefix, improved);
+        } else {
+            int t = target(p);
+            for(int i = t; i < t + p.size[t]; ++i) {
+                int v = p.lab[i];
+                if(i > t) {
+                    foldOrbits(p, prefix);
+                    bool seen = false;
+                    for(int j = t; j < i && !seen; ++j) seen = (find(p.orbits, p.lab[j]) == find(p.orbits, v));
+                    if(seen) continue;
+                }
+                individualize(p, levels[depth+1], v);
+                prefix.push_back(v);
+                search(prefix, improved);
+                prefix.pop_back();
+                if(matched) break;
+                // a new best leaf below invalidates the comparison made here
+                improved = improved && bestTrace.size() > depth && trace[depth] < bestTrace[depth];
+                if(backjump < prefix.size()) break;
+                backjump = SIZE_MAX;
+            }
+        }
+        trace.pop_back();
+    }
+
+    const Certificate& run(const Graph& graph, std::function<bool(const Certificate&)> isKnown = nullptr) {
+        g = &graph;
+        known = std::move(isKnown);
+        matched = false;
+        n = graph.size();
+        best.clear();
+        bestLabel.clear();
+        bestPath.clear();
+        bestTrace.clear();
+        trace.clear();
+        generators.clear();
+        backjump = SIZE_MAX;
+        if((int)levels.size() < n+1) levels.resize(n+1);
+        count.assign(n, 0);
+        histogram.assign(n+2, 0);
+        scratch.assign(n, 0);
+        queued.assign(n, 0);
+        marked.assign(n, 0);
+
+        // root : vertices sorted by colour, one cell per colour
+        Partition& root = levels[0];
+        root.lab.resize(n);
+        root.cell.resize(n);
+        root.size.assign(n, 0);
+        root.folded = 0;
+        std::iota(root.lab.begin(), root.lab.end(), 0);
+        std::stable_sort(root.lab.begin(), root.lab.end(), [&](int a, int b){ return graph.color[a] < graph.color[b]; });
+        root.cells = 0;
+        for(int i = 0; i < n; ++i) {
+            int start = (i > 0 && graph.color[root.lab[i]] == graph.color[root.lab[i-1]]) ? root.cell[root.lab[i-1]] : i;
+            root.cell[root.lab[i]] = start;
+            root.size[start]++;
+            if(start == i) {
+                ++root.cells;
+                enqueue(i);
+            }
+        }
+        std::vector<int> prefix;
+        search(prefix, true);
+        return best;
+    }
+};
+
+// Cheap isomorphism invariant : sorted (colour, degree, #vertices at distance 2) profiles,
+// each packed in one word.
+inline Invariant incidenceProfile(const Graph& g) {
+    Invariant inv(g.size());
+    std::vector<int> mark(g.size(), -1);
+    for(int v = 0; v < g.size(); ++v) {
+        long long reach = 0;
+        mark[v] = v;
+        for(int w : g.adj[v]) {
+            for(int x : g.adj[w]) {
+                reach += (mark[x] != v);
+                mark[x] = v;
+            }
+        }
+        inv[v] = (long long)g.color[v] << 48 | (long long)g.adj[v].size() << 24 | reach;
+    }
+    std::sort(inv.begin(), inv.end());
+    return inv;
+}
+
+// Deduplicates solutions up to isomorphism.
+// Solutions are queued and classified by worker threads, so the search only waits
+// when the queue is full. Each solution is bucketed by invariant and canonized
+// against the certificates already in its bucket ; found(class, solution) is called
+// under the lock for every new class.
+struct Classifier {
+    using Found = std::function<void(long long, long long)>;
+
+    struct Job {
+        Graph graph;
+        Invariant extra;
+        long long solution;
+        Found found;
+    };
+
+    static constexpr size_t capacity = 1 << 10;
+
+    std::unordered_map<Invariant, std::unordered_set<Certificate, VectorHash<int>>, VectorHash<long long>> buckets;
+    std::deque<Job> jobs;
+    std::vector<std::thread> workers;
+    int threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    int busy = 0;
+    bool closing = false;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+
+    long long solutions = 0;
+    long long classes = 0;
+    long long canonized = 0;
+    long long matched = 0;
+    double seconds = 0;
+    double waited = 0;
+
+    Classifier() = default;
+    Classifier(const Classifier&) = delete;
+    Classifier& operator=(const Classifier&) = delete;
+
+    ~Classifier() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        cv.notify_all();
+        for(std::thread& t : workers) t.join();
+    }
+
+    void classify(Graph g, Invariant extra = {}, Found found = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(workers.empty()) {
+            for(int i = 0; i < threads; ++i) workers.emplace_back([this]{ work(); });
+        }
+        if(jobs.size() >= capacity) {
+            auto start = std::chrono::steady_clock::now();
+            cv.wait(lock, [this]{ return jobs.size() < capacity; });
+            waited += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        jobs.push_back({std::move(g), std::move(extra), ++solutions, std::move(found)});
+        cv.notify_all();
+    }
+
+    // waits until every queued solution is classified
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]{ return jobs.empty() && busy == 0; });
+    }
+
+    void work() {
+        Canonizer canonizer;
+        while(true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]{ return !jobs.empty() || closing; });
+                if(jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                ++busy;
+            }
+            cv.notify_all();
+            auto start = std::chrono::steady_clock::now();
+            Invariant inv = incidenceProfile(job.graph);
+            inv.insert(inv.end(), job.extra.begin(), job.extra.end());
+            std::unordered_set<Certificate, VectorHash<int>>* bucket;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                bucket = &buckets[inv];
+            }
+            const Certificate& cert = canonizer.run(job.graph, [this, bucket](const Certificate& c) {
+                std::lock_guard<std::mutex> lock(mutex);
+                return bucket->count(c) > 0;
+            });
+            double spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++canonized;
+                matched += canonizer.matched;
+                seconds += spent;
+                if(bucket->insert(cert).second) {
+                    ++classes;
+                    if(job.found) job.found(classes, job.solution);
+                }
+                --busy;
+            }
+            cv.notify_all();
+        }
+    }
+
+    // solutions classified per second, all workers together
+    double rate() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return seconds > 0 ? canonized / seconds * threads : 0;
+    }
+
+    std::string toString() const {
+        double r = rate();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string s;
+        s += "Solutions : " + std::to_string(solutions) + '\n';
+        s += "Classes   : " + std::to_string(classes) + '\n';
+        s += "Invariant buckets : " + std::to_string(buckets.size()) + '\n';
+        s += "Canonical forms   : " + std::to_string(canonized) + " (" + std::to_string(matched) + " stopped on a known class)\n";
+        s += "Classified per second : " + std::to_string((long long)r) + " (" + std::to_string(threads) + " workers, " + std::to_string(seconds) + " s)\n";
+        s += "Search waited on classification : " + std::to_string(waited) + " s\n";
+        return s;
+    }
+};
@@ -5,10 +5,21 @@
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <bitset>
+#include <memory>
+
+#include "isomorphism.h"
+#include "deck_io.h"
+#include "options.h"
+#include "budget.h"
+#include "trace.h"
 
 #define template_header int P, int U = P*P
 
 #define CHECK_IMMEDIATE_REJECT 1
+#define SIBLING_BATCH 1
 
 struct Logo {
     short id;
@@ -25,59 +36,99 @@ struct Logo {
 template<template_header>
 struct Card {
     short header;
+    short lead;
     short nz;
+    uint16_t used;
     std::array<Logo, P> logos;
     std::array<short, U> active;
-    std::array<short, P> number;
+    std::bitset<U> mask;
+
+    static constexpr uint16_t all = (1 << P) - 1;
 
-    constexpr Card() : header(-1), nz(0), logos(), active() { }
+    constexpr Card() : header(-1), lead(-1), nz(0), used(0), logos(), active(), mask() { }
 
-    void init(short header) {
+    // lead : the value the card takes on column 0
+    void init(short header, short lead) {
         this->header = header;
+        this->lead = lead;
         nz = 0;
+        used = 0;
         std::fill(active.begin(), active.end(), 0);
-        std::fill(number.begin(), number.end(), 0);
+        mask.reset();
     }
 
-    bool hasNext() const {
+    // Values column k may take, taken being the values the other cards of the header
+    // already hold in that column. Cards of header > 0 are permutations, hence ~used.
+    uint16_t legal(short k, uint16_t taken) const {
+        uint16_t m = all & ~taken;
+        if(header > 0) m &= ~used;
+        if(k == 0) m &= (1 << lead);
+        return m;
+    }
+
+    static uint16_t above(short v) {
+        return all & (~0u << (v+1));
+    }
+
+    void place(short k, short v, uint16_t& taken) {
+        logos[k].id = P*k+v;
+        active[P*k+v] = 1;
+        mask[P*k+v] = 1;
+        if(header > 0) used |= (1 << v);
+        taken |= (1 << v);
+    }
+
+    void remove(short k, uint16_t& taken) {
+        short v = logos[k].id % P;
+        active[logos[k].id] = 0;
+        mask[logos[k].id] = 0;
+        if(header > 0) used &= ~(1 << v);
+        taken &= ~(1 << v);
+    }
+
+    bool hasNext(uint16_t taken) const {
         assert(nz > 0);
-        bool ok = (logos[nz-1].id < P*nz-1);
-        return ok;
+        return legal(nz-1, taken) & above(logos[nz-1].id % P);
     }
 
-    void next() {
+    void next(uint16_t& taken) {
+        check();
+        assert(hasNext(taken));
+        uint16_t m = legal(nz-1, taken) & above(logos[nz-1].id % P);
+        remove(nz-1, taken);
+        place(nz-1, __builtin_ctz(m), taken);
+        check();
+    }
+
+    // moves the last logo to value v of its column
+    void jump(short v, uint16_t& taken) {
         check();
-        assert(hasNext());
-        active[logos[nz-1].id] = 0;
-        --number[logos[nz-1].id % P];
-        logos[nz-1].id++;
-        if(header > 0 && nz < P) while(number[logos[nz-1].id % P] && logos[nz-1].id < P*nz-1) logos[nz-1].id++;
-        active[logos[nz-1].id] = 1;
-        ++number[logos[nz-1].id % P];
+        remove(nz-1, taken);
+        place(nz-1, v, taken);
         check();
     }
 
-    void push(int id) {
+    void push(int id, uint16_t& taken) {
         check();
-        if(header > 0) while(number[id % P] > 0) ++id;
-        assert(active[id] == 0);
-        logos[nz].id = id;
-        active[id] = 1;
-        ++number[id % P];
+        assert(id / P == nz && active[id] == 0);
+        place(nz, id % P, taken);
         ++nz;
         check();
     }
 
-    void pushBest() {
-        push(P*nz);
+    // pushes the smallest legal value of the next column, false if there is none
+    bool pushBest(uint16_t& taken) {
+        uint16_t m = legal(nz, taken);
+        if(!m) return false;
+        push(P*nz + __builtin_ctz(m), taken);
+        return true;
     }
 
-    void pop() {
+    void pop(uint16_t& taken) {
         check();
         --nz;
         assert(active[logos[nz].id] == 1);
-        active[logos[nz].id] = 0;
-        --number[logos[nz].id % P];
+        remove(nz, taken);
         check();
     }
 
@@ -104,7 +155,7 @@ struct Card {
                 std::cout << toString() << std::endl;
             }
             assert(active[logos[i].id] == 1);
-            assert(number[logos[i].id % P] >= 0);
+            assert(header == 0 || (used >> (logos[i].id % P)) & 1);
         }
         #endif
     }
@@ -113,14 +164,16 @@ struct Card {
 template<template_header>
 struct Solution {
     std::array<Card<P,U>, P*(P)> cards;
+    // taken[P*h+k] : values the cards of header h hold in column k
+    std::array<uint16_t, P*P> taken;
     short cursor;
     short abortHeight;
     bool abortFlag;
 
-    Solution() : cards(), cursor(0), abortHeight(P), abortFlag(false) {
+    Solution() : cards(), taken(), cursor(0), abortHeight(P), abortFlag(false) {
         for(short i = 0; i < P; ++i) {
             for(short j = 0; j < P; ++j) {
-                cards[P*i+j].init(i);
+                cards[P*i+j].init(i, j);
             }
         }
     }
@@ -129,18 +182,74 @@ struct Solution {
         return Solution();
     }
 
+    // Pins the cards of deck (header then Logo ids, one card per line) in the first slots,
+    // the remaining slots getting the (header, lead) pairs still missing. If only header 0
+    // cards are pinned, the first P cards are still never revisited, as values can be
+    // relabeled column by column around them; otherwise the seed itself is the only
+    // symmetry breaking and the search runs over every remaining slot.
+    // Returns false if deck is not a valid partial solution.
+    bool seed(const std::vector<std::vector<int>>& deck) {
+        if(deck.size() > cards.size()) return false;
+        std::array<std::array<bool, P>, P> pinned;
+        for(auto& p : pinned) std::fill(p.begin(), p.end(), false);
+        short slot = 0;
+        bool rowsOnly = true;
+        for(const std::vector<int>& line : deck) {
+            if(line.size() != P+1) return false;
+            short h = line[0];
+            if(h < 0 || h >= P) return false;
+            rowsOnly = rowsOnly && h == 0;
+            std::vector<int> ids(line.begin()+1, line.end());
+            std::sort(ids.begin(), ids.end());
+            for(short k = 0; k < P; ++k) {
+                if(ids[k] < 0 || ids[k] / P != k) return false;
+            }
+            short lead = ids[0];
+            if(pinned[h][lead]) return false;
+            pinned[h][lead] = true;
+            Card<P,U>& c = cards[slot];
+            c.init(h, lead);
+            for(int id : ids) {
+                uint16_t& t = taken[P*h + id/P];
+                if((t >> (id % P)) & 1) return false;
+                if(h > 0 && (c.used >> (id % P)) & 1) return false;
+                c.push(id, t);
+            }
+            for(short i = 0; i < slot; ++i) {
+                if(!c.compatibleWith(cards[i])) return false;
+            }
+            ++slot;
+        }
+        if(slot > 0) {
+            cursor = slot-1;
+            abortHeight = (rowsOnly ? std::max<short>(P, slot-1) : slot-1);
+        }
+        for(short h = 0; h < P; ++h) {
+            for(short j = 0; j < P; ++j) {
+                if(!pinned[h][j]) cards[slot++].init(h, j);
+            }
+        }
+        return true;
+    }
+
     bool abort() const {
         return abortFlag;
     }
 
-    bool reject() const {
-        if(cards[cursor].nz > 0 && cards[cursor].logos[0].id != cursor % P) return true;
+    short rejectCause() const {
+#if !SIBLING_BATCH
+        if(cards[cursor].nz > 0 && cards[cursor].logos[0].id != cards[cursor].lead) return LEAD;
         for(int i = cursor; i --> 0;) {
             if(!cards[cursor].compatibleWith(cards[i])) {
-                return true;
+                return CONFLICT+i;
             }
         }
-        return false;
+#endif
+        return ACCEPTABLE;
+    }
+
+    bool reject() const {
+        return rejectCause() != ACCEPTABLE;
     }
 
     bool accept() const {
@@ -149,28 +258,196 @@ struct Solution {
         return true;
     }
 
+    uint16_t& column(short k) {
+        return taken[P*cards[cursor].header + k];
+    }
+
     bool hasNext() const {
-        return cards[cursor].hasNext();
+        const Card<P,U>& c = cards[cursor];
+        return c.hasNext(taken[P*c.header + c.nz-1]);
+    }
+
+    short height() const {
+        return P*cursor + cards[cursor].nz;
+    }
+
+    short last() const {
+        return cards[cursor].logos[cards[cursor].nz-1].id;
     }
 
     void next() {
-        cards[cursor].next();
+        cards[cursor].next(column(cards[cursor].nz-1));
     }
 
-    void push() {
+    // false when the next column has no legal value left, the state being left unchanged
+    bool push() {
+        bool fresh = (cards[cursor].nz == P);
+        if(fresh) ++cursor;
+        assert(cursor < P*P);
+        if(cards[cursor].pushBest(column(cards[cursor].nz))) return true;
+        if(fresh) --cursor;
+        return false;
+    }
+
+#if SIBLING_BATCH
+    // values the next push can take : the legal ones minus those of the other headers' cards already met
+    uint16_t siblings(long long& filtered, TraceWriter* trace) const {
+        short c = (cards[cursor].nz == P ? cursor+1 : cursor);
+        const Card<P,U>& open = cards[c];
+        short k = open.nz;
+        uint16_t legal = open.legal(k, taken[P*open.header + k]);
+        uint16_t m = legal;
+        std::array<bool, P*P> meets;
+        for(short i = 0; i < c; ++i) {
+            meets[i] = (cards[i].header != open.header && (cards[i].mask & open.mask).any());
+            if(meets[i]) m &= ~(1 << (cards[i].logos[k].id % P));
+        }
+        filtered += __builtin_popcount(legal) - __builtin_popcount(m);
+        if(trace) {
+            // each value left out goes to the last card ruling it out, as in rejectCause
+            uint16_t left = legal & ~m;
+            for(short i = c; left && i --> 0;) {
+                uint16_t bit = 1 << (cards[i].logos[k].id % P);
+                if(!meets[i] || !(left & bit)) continue;
+                trace->filtered(CONFLICT+i);
+                left &= ~bit;
+            }
+        }
+        return m;
+    }
+
+    void push(short v) {
         if(cards[cursor].nz == P) ++cursor;
-        assert(cursor < P*(P+1));
-        // cards[cursor].push(0);
-        cards[cursor].pushBest();
+        assert(cursor < P*P);
+        short k = cards[cursor].nz;
+        cards[cursor].push(P*k+v, column(k));
     }
 
+    void jump(short v) {
+        cards[cursor].jump(v, column(cards[cursor].nz-1));
+    }
+#endif
+
     void pop() {
-        cards[cursor].pop();
+        cards[cursor].pop(column(cards[cursor].nz-1));
         if(cards[cursor].nz == 0) --cursor;
         if(cursor == abortHeight) abortFlag = true;
     }
 
     std::string toString() const { std::string s; for(short i = 0; i <= cursor; ++i) s += cards[i].toString() + ((1+i)%P == 0 ? "\n\n" : "\n"); return s;}
+
+    // owner[h][id] = lead of the card of header h holding logo id
+    std::array<std::array<short, U>, P> owners() const {
+        std::array<std::array<short, U>, P> owner;
+        for(const Card<P,U>& c : cards) {
+            for(short i = 0; i < c.nz; ++i) owner[c.header][c.logos[i].id] = c.lead;
+        }
+        return owner;
+    }
+
+    // square h-1 as read from header h : square[r][k] = card of header h through the cell
+    // of column k lying on row r (the card of header 0 with lead r)
+    std::array<std::array<short, P>, P> square(const std::array<std::array<short, U>, P>& owner, short h) const {
+        std::array<std::array<short, P>, P> sq;
+        for(short id = 0; id < U; ++id) sq[owner[0][id]][id / P] = owner[h][id];
+        return sq;
+    }
+
+    // number of 2x2 subsquares of each square, sorted
+    Invariant intercalates() const {
+        Invariant inv;
+        std::array<std::array<short, U>, P> owner = owners();
+        for(short h = 1; h < P; ++h) {
+            std::array<std::array<short, P>, P> sq = square(owner, h);
+            long long count = 0;
+            for(short r1 = 0; r1 < P; ++r1) {
+                for(short r2 = r1+1; r2 < P; ++r2) {
+                    for(short c1 = 0; c1 < P; ++c1) {
+                        for(short c2 = c1+1; c2 < P; ++c2) {
+                            count += (sq[r1][c1] == sq[r2][c2] && sq[r1][c2] == sq[r2][c1]);
+                        }
+                    }
+                }
+            }
+            inv.push_back(count);
+        }
+        std::sort(inv.begin(), inv.end());
+        return inv;
+    }
+
+    // cells, rows (header 0), columns, symbols of each square and the squares themselves,
+    // so that isomorphic graphs are MOLS equal up to row, column, symbol and square permutations
+    Graph toGraph() const {
+        enum { CELL, ROW, COLUMN, SYMBOL, SQUARE };
+        Graph g;
+        for(int id = 0; id < U; ++id) g.addVertex(CELL);
+        for(short k = 0; k < P; ++k) {
+            int column = g.addVertex(COLUMN);
+            for(short v = 0; v < P; ++v) g.addEdge(column, P*k+v);
+        }
+        int firstSquare = g.size();
+        for(short h = 1; h < P; ++h) g.addVertex(SQUARE);
+        for(const Card<P,U>& c : cards) {
+            int line = g.addVertex(c.header == 0 ? ROW : SYMBOL);
+            if(c.header > 0) g.addEdge(firstSquare + c.header-1, line);
+            for(short i = 0; i < c.nz; ++i) g.addEdge(line, c.logos[i].id);
+        }
+        return g;
+    }
+
+    // Writes the projective plane of order P these MOLS stand for to w : every card gets
+    // the point at infinity U+header, column k becomes the card P*k..P*k+P-1 plus U+P,
+    // and the line at infinity holds U..U+P. The affine plane is the same deck without
+    // the points and the line at infinity.
+    // Cards are first built as bitsets to check that any two of them share exactly one
+    // symbol (at most one for the affine plane, whose P*P+P lines of P points then cover
+    // every pair of points once), and nothing is written (not even comment) if they do not.
+    bool emitPlane(DeckWriter& w, const std::string& comment, bool affine) const {
+        const short k = (affine ? P : P+1);
+        std::array<std::array<short, P+1>, U+P+1> lines;
+        std::array<std::bitset<U+P+1>, U+P+1> deck;
+        short n = 0;
+        short size = 0;
+        auto add = [&](short id) {
+            if(size <= P) lines[n][size] = id;
+            ++size;
+            deck[n][id] = 1;
+        };
+        auto end = [&]() {
+            ++n;
+            size = 0;
+        };
+        for(const Card<P,U>& c : cards) {
+            for(short i = 0; i < c.nz; ++i) add(c.logos[i].id);
+            if(!affine) add(U+c.header);
+            end();
+        }
+        for(short col = 0; col < P; ++col) {
+            for(short v = 0; v < P; ++v) add(P*col+v);
+            if(!affine) add(U+P);
+            end();
+        }
+        if(!affine) {
+            for(short h = 0; h <= P; ++h) add(U+h);
+            end();
+        }
+
+        for(short i = 0; i < n; ++i) {
+            if((short)deck[i].count() != k) return false;
+            for(short j = i+1; j < n; ++j) {
+                size_t shared = (deck[i] & deck[j]).count();
+                if(shared > 1 || (!affine && shared == 0)) return false;
+            }
+        }
+
+        if(!comment.empty()) w.comment(comment);
+        for(short i = 0; i < n; ++i) {
+            for(short j = 0; j < k; ++j) w.symbol(lines[i][j]);
+            w.endCard();
+        }
+        w.flush();
+        return true;
+    }
 };
 
 
@@ -188,14 +465,59 @@ struct Solver {
 #if CHECK_IMMEDIATE_REJECT
     long long immediatelyRejected = 0;
     bool immediateCandidate = false;
+#endif
+#if SIBLING_BATCH
+    long long filtered = 0;
 #endif
     bool debugMode = false;
+    bool enumerate = false;
+    Classifier classifier;
+    DeckWriter* deck = nullptr;
+    bool affine = false;
+    TraceWriter* trace = nullptr;
+
+    void quit() {
+        if(trace) trace->close();
+        std::exit(0);
+    }
+
+    void emit(const Solution<P>& candidate, const std::string& comment = "") {
+        if(!deck) return;
+        if(!candidate.emitPlane(*deck, comment, affine)) {
+            std::cout << "Invalid plane, deck not written" << "\n";
+        } else if(!deck->ok()) {
+            std::cout << "Cannot write deck to " << deck->path << "\n";
+        } else {
+            std::cout << "Deck of " << (affine ? U+P : U+P+1) << " cards written" << "\n";
+        }
+    }
     std::chrono::system_clock::time_point begin;
     std::chrono::system_clock::time_point current;
 
     short height = 0;
     short summit = 0;
-    std::array<long long, P*U> spent;
+    std::array<long long, P*U+1> spent;
+
+    Budget budget;
+    short deepestHeight = -1;
+    Solution<P> deepest;
+
+    void budgetExhausted() {
+        log(deepest);
+        std::cout << "Budget exhausted" << std::endl;
+        std::cout << "Deepest partial solution : " << deepestHeight << " / " << P*U << "\n";
+        std::cout << "Nodes per height :\n";
+        for(int i = 0; i <= P*U; ++i) {
+            if(spent[i]) std::cout << i << " " << spent[i] << "\n";
+        }
+        if(enumerate) {
+            classifier.finish();
+            std::cout << classifier.toString();
+        }
+        std::cout << "Seconds : " << budget.seconds() << "\n";
+        std::cout << "Total calls : " << calls << "\n";
+        quit();
+    }
 
     std::string repartition() const {
         std::string s;
@@ -220,8 +542,16 @@ struct Solver {
             << "Target  : " << P*U << '\n'
             << (calls / 1.0e6) << " Mcalls\n"
             << (calls / 1.0e6) / (elapsed.count() / 1.0e9) << " Mcalls/s" << '\n'
+            << (enumerate ? std::to_string((long long)classifier.rate()) + " classified/s\n" : "")
 #if CHECK_IMMEDIATE_REJECT
+#if SIBLING_BATCH
+            << (100.0 * immediatelyRejected / (calls + filtered)) << "% reject \n"
+#else
             << (100.0 * immediatelyRejected / calls) << "% reject \n"
+#endif
+#endif
+#if SIBLING_BATCH
+            << (filtered / 1.0e6) << " M siblings filtered\n"
 #endif
             // << repartition()
             << candidate.toString() 
@@ -230,23 +560,35 @@ struct Solver {
 
     void backtrack(Solution<P>& candidate) {
         calls++;
-        height = P*candidate.cursor + candidate.cards[candidate.cursor].nz;
+        height = candidate.height();
         summit = std::max(summit, height);
         ++spent[height];
         if(calls % ( 1 << 21 ) == 0) {
             log(candidate);
         }
+        if(budget.exhausted(calls)) {
+            budgetExhausted();
+        }
 
         if(candidate.abort()) {
             log(candidate);
+            if(enumerate) {
+                classifier.finish();
+                std::cout << "Search exhausted" << std::endl;
+                std::cout << classifier.toString();
+                std::cout << "Total calls : " << calls << "\n";
+                quit();
+            }
             std::cout << "No solution found" << std::endl;
             std::cout << "Total calls : " << calls << "\n";
-            std::exit(0);
+            quit();
         }
 
+        short cause = candidate.rejectCause();
 #if CHECK_IMMEDIATE_REJECT
         immediateCandidate = true;
-        if(candidate.reject()) {
+        if(cause != ACCEPTABLE) {
+            if(trace) trace->reject(cause);
             if(immediateCandidate) {
                 if(debugMode) std::cout << candidate.toString() << std::endl;
                 immediatelyRejected++;
@@ -256,21 +598,62 @@ struct Solver {
         }
         immediateCandidate = false;
 #else
-        if(candidate.reject()) return;
+        if(cause != ACCEPTABLE) {
+            if(trace) trace->reject(cause);
+            return;
+        }
 #endif
+        if(height > deepestHeight) {
+            deepestHeight = height;
+            deepest = candidate;
+        }
         if(candidate.accept()) {
+            if(trace) trace->accept();
+            if(enumerate) {
+                classifier.classify(candidate.toGraph(), candidate.intercalates(), [this, candidate](long long cls, long long solution) {
+                    std::cout << "Class " << cls << " (solution " << solution << ")\n";
+                    std::cout << candidate.toString() << std::endl;
+                    emit(candidate, "class " + std::to_string(cls));
+                });
+                return;
+            }
             log(candidate);
             std::cout << "Solution found" << std::endl;
+            emit(candidate);
             std::cout << "Total calls : " << calls << "\n";
-            std::exit(0);
+            quit();
         }
 
-        candidate.push();
+#if SIBLING_BATCH
+        long long before = filtered;
+        uint16_t values = candidate.siblings(filtered, trace);
+#if CHECK_IMMEDIATE_REJECT
+        immediatelyRejected += filtered - before;
+#endif
+        if(!values) return;
+        candidate.push((short)__builtin_ctz(values));
+        if(trace) trace->push(candidate.last());
+        backtrack(candidate);
+        values &= values-1;
+        while(values) {
+            short previous = candidate.last();
+            candidate.jump((short)__builtin_ctz(values));
+            if(trace) trace->next(candidate.last() - previous);
+            backtrack(candidate);
+            values &= values-1;
+        }
+#else
+        if(!candidate.push()) return;
+        if(trace) trace->push(candidate.last());
         backtrack(candidate);
         while(candidate.hasNext()) {
+            short previous = candidate.last();
             candidate.next();
+            if(trace) trace->next(candidate.last() - previous);
             backtrack(candidate);
         }
+#endif
+        if(trace) trace->pop();
         candidate.pop();
 
     }
@@ -282,34 +665,80 @@ struct Solver {
 };
 
 template<int P>
-void run(bool debugMode) {
+void run(bool debugMode, bool enumerate, const char* seed, const char* deckPath, const Options& options) {
     Solver<P> s;
     s.debugMode = debugMode;
+    s.enumerate = enumerate;
+    s.budget.read(options);
+    const char* tracePath = options.get("trace");
+    const char* plane = options.get("plane");
+    if(plane && std::strcmp(plane, "affine") != 0 && std::strcmp(plane, "projective") != 0) {
+        std::cout << "Unknown plane " << plane << "\n";
+        return;
+    }
+    s.affine = (plane && std::strcmp(plane, "affine") == 0);
+    std::unique_ptr<DeckWriter> deck;
+    if(deckPath) {
+        deck = std::make_unique<DeckWriter>(deckPath);
+        s.deck = deck.get();
+    }
     Solution<P> sol = Solution<P>::root();
+    if(seed) {
+        std::vector<std::vector<int>> deck;
+        if(!readDeck(seed, deck) || !sol.seed(deck)) {
+            std::cout << "Invalid partial deck " << seed << "\n";
+            return;
+        }
+        std::cout << "Seed : \n" << sol.toString() << "\n";
+    }
+    std::unique_ptr<TraceWriter> trace;
+    if(tracePath) {
+        TraceHeader header;
+        std::strncpy(header.solver, "mols", sizeof(header.solver)-1);
+        header.P = P;
+        header.rootHeight = sol.height();
+        trace = std::make_unique<TraceWriter>(tracePath, header);
+        if(!trace->ok()) {
+            std::cout << "Cannot write trace to " << tracePath << "\n";
+            return;
+        }
+        s.trace = trace.get();
+    }
     s.backtrack(sol);
+    if(enumerate) {
+        s.classifier.finish();
+        std::cout << s.classifier.toString();
+    }
     std::cout << "Total calls : " << s.calls << "\n";
 }
 
 int main(int argc, const char* argv[]) {
-    if(argc != 2 && argc != 3) {
-        std::cout << "Usage : exe P debugMode\n";
+    Options options(argc, argv);
+    const std::vector<std::string>& args = options.positional;
+    if(args.size() < 1 || args.size() > 5) {
+        std::cout << "Usage : exe P debugMode enumerate seedFile deckFile (- for no seedFile)"
+                  << " [--trace traceFile] [--max-nodes N] [--max-seconds S] [--plane projective|affine]\n";
     } else {
         int P;
         int d = false;
-        if(argc >= 2) P = std::atoi(argv[1]);
-        if(argc >= 3) d = std::atoi(argv[2]);
+        int e = false;
+        if(args.size() >= 1) P = std::atoi(args[0].c_str());
+        if(args.size() >= 2) d = std::atoi(args[1].c_str());
+        if(args.size() >= 3) e = std::atoi(args[2].c_str());
+        const char* seed = (args.size() >= 4 && args[3] != "-" ? args[3].c_str() : nullptr);
+        const char* deckPath = (args.size() >= 5 ? args[4].c_str() : nullptr);
         switch(P) {
-            case 1: run<1>(d); break;
-            case 2: run<2>(d); break;
-            case 3: run<3>(d); break;
-            case 4: run<4>(d); break;
-            case 5: run<5>(d); break;
-            case 6: run<6>(d); break;
-            case 7: run<7>(d); break;
-            case 8: run<8>(d); break;
-            case 9: run<9>(d); break;
-            case 10: run<10>(d); break;
+            case 1: run<1>(d, e, seed, deckPath, options); break;
+            case 2: run<2>(d, e, seed, deckPath, options); break;
+            case 3: run<3>(d, e, seed, deckPath, options); break;
+            case 4: run<4>(d, e, seed, deckPath, options); break;
+            case 5: run<5>(d, e, seed, deckPath, options); break;
+            case 6: run<6>(d, e, seed, deckPath, options); break;
+            case 7: run<7>(d, e, seed, deckPath, options); break;
+            case 8: run<8>(d, e, seed, deckPath, options); break;
+            case 9: run<9>(d, e, seed, deckPath, options); break;
+            case 10: run<10>(d, e, seed, deckPath, options); break;
             default: std::cout << "P = " << P << " not supported yet\n";
         }
     }
-}
\ No newline at end of file
+}
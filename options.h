@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+// Splits the command line into positional arguments and "--name value" options.
+struct Options {
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> named;
+
+    Options(int argc, const char* argv[]) {
+        for(int i = 1; i < argc; ++i) {
+            std::string a = argv[i];
+            if(a.size() > 2 && a.compare(0, 2, "--") == 0 && i+1 < argc) {
+                named[a.substr(2)] = argv[++i];
+            } else {
+                positional.push_back(a);
+            }
+        }
+    }
+
+    const char* get(const std::string& name) const {
+        auto it = named.find(name);
+        return it == named.end() ? nullptr : it->second.c_str();
+    }
+};
@@ -4,10 +4,20 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <bitset>
+#include <memory>
+
+#include "isomorphism.h"
+#include "deck_io.h"
+#include "options.h"
+#include "budget.h"
+#include "trace.h"
 
 #define template_header int P, int U = P*P
 
 #define CHECK_IMMEDIATE_REJECT 1
+#define CAPACITY_LOOKAHEAD 1
+#define SIBLING_BATCH 1
 
 struct Logo {
     short id;
@@ -27,13 +37,15 @@ struct Card {
     short nz;
     std::array<Logo, P> logos;
     std::array<short, U> active;
+    std::bitset<U> mask;
 
-    constexpr Card() : header(-1), nz(0), logos(), active() { }
+    constexpr Card() : header(-1), nz(0), logos(), active(), mask() { }
 
     void init(short header) {
         this->header = header;
         nz = 0;
         std::fill(active.begin(), active.end(), 0);
+        mask.reset();
     }
 
     bool hasNext() const {
@@ -45,9 +57,18 @@ struct Card {
     void next() {
         check();
         assert(hasNext());
+        jump(logos[nz-1].id+1);
+    }
+
+    // moves the last logo up to id
+    void jump(short id) {
+        check();
+        assert(id > logos[nz-1].id && id < U);
         active[logos[nz-1].id] = 0;
-        logos[nz-1].id++;
-        active[logos[nz-1].id] = 1;
+        mask[logos[nz-1].id] = 0;
+        logos[nz-1].id = id;
+        active[id] = 1;
+        mask[id] = 1;
         check();
     }
 
@@ -56,6 +77,7 @@ struct Card {
         assert(active[id] == 0);
         logos[nz].id = id;
         active[id] = 1;
+        mask[id] = 1;
         ++nz;
         check();
     }
@@ -69,6 +91,7 @@ struct Card {
         --nz;
         assert(active[logos[nz].id] == 1);
         active[logos[nz].id] = 0;
+        mask[logos[nz].id] = 0;
         check();
     }
 
@@ -102,33 +125,158 @@ struct Solution {
     short cursor;
     bool abortFlag;
 
+#if CAPACITY_LOOKAHEAD
+    // Every logo must end up on exactly one card of each header, and every pair of logos
+    // on exactly one card. Counters are kept up to date by push/next/pop :
+    // coverCount[h][s] cards of header h holding s, pairCount[U*a+b] cards holding a and b,
+    // empty[h] cards of header h without any logo yet.
+    std::array<std::array<short, U>, P+1> coverCount;
+    std::array<short, U*U> pairCount;
+    std::array<short, P+1> empty;
+    std::array<std::bitset<U>, P+1> uncovered;
+    std::array<std::bitset<U>, U> partners;
+#endif
+
     Solution() : cards(), cursor(0), abortFlag(false) {
         for(short i = 0; i < P+1; ++i) {
             for(short j = 0; j < P; ++j) {
                 cards[P*i+j].init(i);
             }
         }
+#if CAPACITY_LOOKAHEAD
+        resetTracking();
+#endif
     }
 
     static Solution root() {
         return Solution();
     }
 
+    // Pins the cards of deck (header then Logo ids, one card per line) in the first slots,
+    // the remaining slots getting the headers still missing. The search then only runs over
+    // the remaining slots. Returns false if deck is not a valid partial solution.
+    bool seed(const std::vector<std::vector<int>>& deck) {
+        if(deck.size() > cards.size()) return false;
+        std::array<short, P+1> count;
+        std::fill(count.begin(), count.end(), 0);
+        short slot = 0;
+        for(const std::vector<int>& line : deck) {
+            if(line.size() != P+1) return false;
+            short h = line[0];
+            if(h < 0 || h > P || count[h] == P) return false;
+            ++count[h];
+            Card<P,U>& c = cards[slot];
+            c.init(h);
+            std::vector<int> ids(line.begin()+1, line.end());
+            std::sort(ids.begin(), ids.end());
+            for(int id : ids) {
+                if(id < 0 || id >= U || c.active[id]) return false;
+                c.push(id);
+            }
+            for(short i = 0; i < slot; ++i) {
+                if(!c.compatibleWith(cards[i])) return false;
+            }
+            ++slot;
+        }
+        cursor = (slot == 0 ? 0 : slot-1);
+        for(short h = 0; h <= P; ++h) {
+            for(short j = count[h]; j < P; ++j) cards[slot++].init(h);
+        }
+#if CAPACITY_LOOKAHEAD
+        resetTracking();
+        for(short i = 0; i <= cursor; ++i) {
+            for(short k = 0; k < cards[i].nz; ++k) track(cards[i], k, 1);
+        }
+#endif
+        return true;
+    }
+
+#if CAPACITY_LOOKAHEAD
+    void resetTracking() {
+        for(auto& c : coverCount) std::fill(c.begin(), c.end(), 0);
+        std::fill(pairCount.begin(), pairCount.end(), 0);
+        std::fill(empty.begin(), empty.end(), P);
+        for(auto& u : uncovered) u.set();
+        for(short a = 0; a < U; ++a) {
+            partners[a].set();
+            partners[a][a] = 0;
+        }
+    }
+
+    // adds (delta = 1) or removes (delta = -1) logo k of c, logos before k being already counted
+    void track(const Card<P,U>& c, short k, short delta) {
+        short id = c.logos[k].id;
+        short h = c.header;
+        if(k == 0) empty[h] -= delta;
+        coverCount[h][id] += delta;
+        uncovered[h][id] = (coverCount[h][id] == 0);
+        for(short i = 0; i < k; ++i) {
+            short o = c.logos[i].id;
+            pairCount[U*o+id] += delta;
+            pairCount[U*id+o] += delta;
+            bool free = (pairCount[U*o+id] == 0);
+            partners[o][id] = free;
+            partners[id][o] = free;
+        }
+    }
+
+    // Necessary conditions for the current state to extend to a full solution.
+    // avail[h] holds the logos a card of header h can still receive : any uncovered logo
+    // while h has an empty card, and for the open card the uncovered logos above its
+    // last one that pair freshly with all its logos (logos are pushed in increasing order).
+    bool feasible() const {
+        const Card<P,U>& open = cards[cursor];
+        std::array<std::bitset<U>, P+1> avail;
+        for(short h = 0; h <= P; ++h) {
+            if(empty[h] > 0) avail[h] = uncovered[h];
+        }
+        if(open.nz > 0 && open.nz < P) {
+            short hc = open.header;
+            std::bitset<U> host = uncovered[hc] & (~std::bitset<U>() << (open.logos[open.nz-1].id+1));
+            for(short i = 0; i < open.nz; ++i) host &= partners[open.logos[i].id];
+            if((short)host.count() < P-open.nz) return false;
+            if((short)(uncovered[hc] & ~host).count() > P*empty[hc]) return false;
+            for(short i = 0; i < open.nz; ++i) host[open.logos[i].id] = 1;
+            avail[hc] |= host;
+        }
+        for(short h = 0; h <= P; ++h) {
+            if((uncovered[h] & ~avail[h]).any()) return false;
+        }
+        for(short a = 0; a < U; ++a) {
+            std::bitset<U> reach;
+            for(short h = 0; h <= P; ++h) {
+                if(avail[h][a]) reach |= avail[h];
+            }
+            if((partners[a] & ~reach).any()) return false;
+        }
+        return true;
+    }
+#endif
+
     bool abort() const {
         return abortFlag;
     }
 
-    bool reject() const {
+    short rejectCause() const {
+#if !SIBLING_BATCH
         for(int i = 0; i < cursor; ++i) {
             if(!cards[cursor].compatibleWith(cards[i])) {
                 // std::cout << "rejected : incompatibility : " << std::endl;
                 // std::cout << cards[cursor].toString() << std::endl;
                 // std::cout << "and"  << std::endl;
                 // std::cout << cards[i].toString()  << std::endl;
-                return true;
+                return CONFLICT+i;
             }
         }
-        return false;
+#endif
+#if CAPACITY_LOOKAHEAD
+        if(!feasible()) return LOOKAHEAD;
+#endif
+        return ACCEPTABLE;
+    }
+
+    bool reject() const {
+        return rejectCause() != ACCEPTABLE;
     }
 
     bool accept() const {
@@ -141,8 +289,22 @@ struct Solution {
         return cards[cursor].hasNext();
     }
 
+    short height() const {
+        return P*cursor + cards[cursor].nz;
+    }
+
+    short last() const {
+        return cards[cursor].logos[cards[cursor].nz-1].id;
+    }
+
     void next() {
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, -1);
+#endif
         cards[cursor].next();
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, 1);
+#endif
     }
 
     void push() {
@@ -150,15 +312,77 @@ struct Solution {
         assert(cursor < P*(P+1));
         // cards[cursor].push(0);
         cards[cursor].pushBest();
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, 1);
+#endif
+    }
+
+#if SIBLING_BATCH
+    // logos the next push can take : its range minus every earlier card the open card meets
+    std::bitset<U> siblings(long long& filtered, TraceWriter* trace) const {
+        short c = (cards[cursor].nz == P ? cursor+1 : cursor);
+        const Card<P,U>& open = cards[c];
+        short lo = (open.nz == 0 ? 0 : open.logos[open.nz-1].id+1);
+        short hi = U-P+open.nz;
+        std::bitset<U> range = (~std::bitset<U>() << lo) & (~std::bitset<U>() >> (U-1-hi));
+        std::bitset<U> s = range;
+        std::array<bool, P*(P+1)> meets;
+        for(short i = 0; i < c; ++i) {
+            meets[i] = (cards[i].header == open.header || (cards[i].mask & open.mask).any());
+            if(meets[i]) s &= ~cards[i].mask;
+        }
+        filtered += range.count() - s.count();
+        if(trace) {
+            // each logo left out goes to the first card ruling it out, as in rejectCause
+            std::bitset<U> left = range & ~s;
+            for(short i = 0; i < c && left.any(); ++i) {
+                if(!meets[i]) continue;
+                for(size_t n = (cards[i].mask & left).count(); n > 0; --n) trace->filtered(CONFLICT+i);
+                left &= ~cards[i].mask;
+            }
+        }
+        return s;
+    }
+
+    void push(short id) {
+        if(cards[cursor].nz == P) ++cursor;
+        assert(cursor < P*(P+1));
+        cards[cursor].push(id);
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, 1);
+#endif
+    }
+
+    void jump(short id) {
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, -1);
+#endif
+        cards[cursor].jump(id);
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, 1);
+#endif
     }
+#endif
 
     void pop() {
+#if CAPACITY_LOOKAHEAD
+        track(cards[cursor], cards[cursor].nz-1, -1);
+#endif
         cards[cursor].pop();
         if(cards[cursor].nz == 0) --cursor;
         if(cursor == P+2*U+1) abortFlag = true;
     }
 
     std::string toString() const { std::string s; for(short i = 0; i <= cursor; ++i) s += cards[i].toString() + ((1+i)%P == 0 ? "\n\n" : "\n"); return s;}
+
+    Graph toGraph() const {
+        std::vector<std::vector<int>> deck(cursor+1);
+        for(short i = 0; i <= cursor; ++i) {
+            deck[i].reserve(cards[i].nz);
+            for(short j = 0; j < cards[i].nz; ++j) deck[i].push_back(cards[i].logos[j].id);
+        }
+        return Graph::ofDeck(deck, U);
+    }
 };
 
 
@@ -172,17 +396,56 @@ struct Solver {
     }
 
     long long calls = 0;
+    bool enumerate = false;
+    Classifier classifier;
+    TraceWriter* trace = nullptr;
+
+    void quit() {
+        if(trace) trace->close();
+        std::exit(0);
+    }
 
 #if CHECK_IMMEDIATE_REJECT
     long long immediatelyRejected = 0;
     bool immediateCandidate = false;
+#endif
+#if SIBLING_BATCH
+    long long filtered = 0;
 #endif
     std::chrono::system_clock::time_point begin;
     std::chrono::system_clock::time_point current;
 
+    Budget budget;
+    // summit counts every state, deepest only the ones that passed reject
+    short summit = 0;
+    short deepestHeight = -1;
+    Solution<P> deepest;
+
+    void budgetExhausted() {
+        std::cout << "Budget exhausted" << std::endl;
+        std::cout << deepest.toString() << std::endl;
+        std::cout << "Deepest partial solution : " << deepestHeight << " / " << P*P*(P+1) << "\n";
+        std::cout << "Max height : " << summit << "\n";
+#if CHECK_IMMEDIATE_REJECT
+        std::cout << "Immediately rejected : " << immediatelyRejected << "\n";
+#endif
+#if SIBLING_BATCH
+        std::cout << "Filtered siblings : " << filtered << "\n";
+#endif
+        if(enumerate) {
+            classifier.finish();
+            std::cout << classifier.toString();
+        }
+        std::cout << "Seconds : " << budget.seconds() << "\n";
+        std::cout << "Total calls : " << calls << "\n";
+        quit();
+    }
+
     void backtrack(Solution<P>& candidate) {
         // std::cout << candidate.toString() << '\n';
         calls++;
+        short height = candidate.height();
+        summit = std::max(summit, height);
         if(calls % 10000000 == 0) {
             current = std::chrono::high_resolution_clock::now();
             auto elapsed = current - begin;
@@ -190,23 +453,43 @@ struct Solver {
             std::cout 
                 << (calls / 1.0e6) << " Mcalls\n"
                 << (calls / 1.0e6) / (elapsed.count() / 1.0e9) << " Mcalls/s" << '\n'
+                << (enumerate ? std::to_string((long long)classifier.rate()) + " classified/s\n" : "")
 #if CHECK_IMMEDIATE_REJECT
+#if SIBLING_BATCH
+                << (100.0 * immediatelyRejected / (calls + filtered)) << "% reject \n"
+#else
                 << (100.0 * immediatelyRejected / calls) << "% reject \n"
+#endif
+#endif
+#if SIBLING_BATCH
+                << (filtered / 1.0e6) << " M siblings filtered\n"
 #endif
                 << candidate.toString() 
                 << std::endl;    
         }
+        if(budget.exhausted(calls)) {
+            budgetExhausted();
+        }
 
         if(candidate.abort()) {
+            if(enumerate) {
+                classifier.finish();
+                std::cout << "Search exhausted" << std::endl;
+                std::cout << classifier.toString();
+                std::cout << "Total calls : " << calls << "\n";
+                quit();
+            }
             std::cout << "No solution found" << std::endl;
             std::cout << "Total calls : " << calls << "\n";
-            std::exit(0);
+            quit();
         }
 
 #if CHECK_IMMEDIATE_REJECT
         immediateCandidate = true;
 #endif
-        if(candidate.reject()) {
+        short cause = candidate.rejectCause();
+        if(cause != ACCEPTABLE) {
+            if(trace) trace->reject(cause);
 #if CHECK_IMMEDIATE_REJECT
             if(immediateCandidate) {
                 // std::cout << candidate.toString() << std::endl;
@@ -219,23 +502,60 @@ struct Solver {
 #if CHECK_IMMEDIATE_REJECT
         immediateCandidate = false;
 #endif
+        if(height > deepestHeight) {
+            deepestHeight = height;
+            deepest = candidate;
+        }
         if(candidate.accept()) {
+            if(trace) trace->accept();
+            if(enumerate) {
+                classifier.classify(candidate.toGraph(), {}, [candidate](long long cls, long long solution) {
+                    std::cout << "Class " << cls << " (solution " << solution << ")\n";
+                    std::cout << candidate.toString() << std::endl;
+                });
+                return;
+            }
             std::cout << "Solution found" << std::endl;
             std::cout << candidate.toString() << std::endl;
             std::cout << "Total calls : " << calls << "\n";
-            std::exit(0);
+            quit();
         }
 
+#if SIBLING_BATCH
+        static_assert(U <= 64, "siblings are walked as a 64 bit mask");
+        long long before = filtered;
+        unsigned long long bits = candidate.siblings(filtered, trace).to_ullong();
+#if CHECK_IMMEDIATE_REJECT
+        immediatelyRejected += filtered - before;
+#endif
+        if(!bits) return;
+        candidate.push((short)__builtin_ctzll(bits));
+        if(trace) trace->push(candidate.last());
+        backtrack(candidate);
+        bits &= bits-1;
+        while(bits) {
+            short previous = candidate.last();
+            candidate.jump((short)__builtin_ctzll(bits));
+            if(trace) trace->next(candidate.last() - previous);
+            backtrack(candidate);
+            bits &= bits-1;
+        }
+#else
         candidate.push();
+        if(trace) trace->push(candidate.last());
         backtrack(candidate);
         while(true) {
             if(candidate.hasNext()) {
+                short previous = candidate.last();
                 candidate.next();
+                if(trace) trace->next(candidate.last() - previous);
                 backtrack(candidate);
             } else {
                 break;
             }
         }
+#endif
+        if(trace) trace->pop();
         candidate.pop();
 
     }
@@ -246,23 +566,56 @@ struct Solver {
 };
 
 template<int P>
-void run() {
+void run(bool enumerate, const char* seed, const Options& options) {
     Solver<P> s;
+    s.enumerate = enumerate;
+    s.budget.read(options);
+    const char* tracePath = options.get("trace");
     Solution<P> sol = Solution<P>::root();
+    if(seed) {
+        std::vector<std::vector<int>> deck;
+        if(!readDeck(seed, deck) || !sol.seed(deck)) {
+            std::cout << "Invalid partial deck " << seed << "\n";
+            return;
+        }
+        std::cout << "Seed : \n" << sol.toString() << "\n";
+    }
+    std::unique_ptr<TraceWriter> trace;
+    if(tracePath) {
+        TraceHeader header;
+        std::strncpy(header.solver, "stack", sizeof(header.solver)-1);
+        header.P = P;
+        header.rootHeight = sol.height();
+        trace = std::make_unique<TraceWriter>(tracePath, header);
+        if(!trace->ok()) {
+            std::cout << "Cannot write trace to " << tracePath << "\n";
+            return;
+        }
+        s.trace = trace.get();
+    }
     s.backtrack(sol);
+    if(enumerate) {
+        s.classifier.finish();
+        std::cout << s.classifier.toString();
+    }
     std::cout << "Total calls : " << s.calls << "\n";
 }
 
 int main(int argc, const char* argv[]) {
-    if(argc != 2) {
-        std::cout << "Usage : exe P\n";
+    Options options(argc, argv);
+    const std::vector<std::string>& args = options.positional;
+    if(args.size() < 1 || args.size() > 3) {
+        std::cout << "Usage : exe P enumerate seedFile [--trace traceFile] [--max-nodes N] [--max-seconds S]\n";
     } else {
-        if(std::atoi(argv[1]) == 1) run<1>();
-        if(std::atoi(argv[1]) == 2) run<2>();
-        if(std::atoi(argv[1]) == 3) run<3>();
-        if(std::atoi(argv[1]) == 4) run<4>();
-        if(std::atoi(argv[1]) == 5) run<5>();
-        if(std::atoi(argv[1]) == 6) run<6>();
-        if(std::atoi(argv[1]) == 7) run<7>();
-    }
-}
\ No newline at end of file
+        int P = std::atoi(args[0].c_str());
+        bool e = (args.size() >= 2 && std::atoi(args[1].c_str()));
+        const char* seed = (args.size() >= 3 ? args[2].c_str() : nullptr);
+        if(P == 1) run<1>(e, seed, options);
+        if(P == 2) run<2>(e, seed, options);
+        if(P == 3) run<3>(e, seed, options);
+        if(P == 4) run<4>(e, seed, options);
+        if(P == 5) run<5>(e, seed, options);
+        if(P == 6) run<6>(e, seed, options);
+        if(P == 7) run<7>(e, seed, options);
+    }
+}
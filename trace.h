@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Search trace : one event per backtrack step, in the order the solver performs them.
+// PUSH and NEXT open a node (a backtrack call), POP closes the node and goes back to its
+// parent, REJECT and ACCEPT tag the current node. FILTERED stands for a child the solver
+// never opened because its sibling mask already ruled it out, with the same cause REJECT
+// would have reported for it. Depth is implicit, NEXT only stores the increase of the
+// logo id, so most events fit in a single byte :
+// tag = (type << 5) | payload, with payload 31 meaning "31 + varint that follows".
+enum TraceEvent : uint8_t { PUSH = 0, NEXT = 1, POP = 2, REJECT = 3, ACCEPT = 4, FILTERED = 5 };
+
+// Reject causes : a card conflicting with the card in slot i is reported as CONFLICT+i.
+enum RejectCause : short { ACCEPTABLE = -1, LEAD = 0, LOOKAHEAD = 1, CONFLICT = 2 };
+
+struct TraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t P;
+    uint32_t rootHeight;
+    char solver[16];
+
+    static constexpr uint32_t currentVersion = 1;
+
+    TraceHeader() : magic{'D', 'T', 'R', 'C'}, version(currentVersion), P(0), rootHeight(0), solver() { }
+
+    bool valid() const { return std::memcmp(magic, "DTRC", 4) == 0 && version == currentVersion; }
+};
+
+// Records events into a ring of chunks. A full chunk is handed to a background thread
+// which writes it to disk, so the solver only ever pays for a few byte stores.
+struct TraceWriter {
+    static constexpr int chunkSize = 1 << 20;
+    static constexpr int chunks = 8;
+
+    std::vector<uint8_t> ring;
+    std::array<int, chunks> filled;
+    int head;
+    int tail;
+    int pending;
+    uint8_t* pos;
+    uint8_t* end;
+    bool closing;
+    std::FILE* out;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread flusher;
+
+    TraceWriter(const std::string& path, const TraceHeader& header)
+        : ring(chunkSize*chunks), filled(), head(0), tail(0), pending(0),
+          pos(ring.data()), end(ring.data()+chunkSize), closing(false),
+          out(std::fopen(path.c_str(), "wb")) {
+        if(!out) return;
+        std::fwrite(&header, sizeof(header), 1, out);
+        flusher = std::thread([this]{ flushLoop(); });
+    }
+
+    ~TraceWriter() {
+        close();
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool ok() const { return out != nullptr; }
+
+    void event(TraceEvent type, uint32_t payload) {
+        if(end - pos < 8) rotate();
+        if(payload < 31) {
+            *pos++ = uint8_t(type << 5 | payload);
+            return;
+        }
+        *pos++ = uint8_t(type << 5 | 31);
+        payload -= 31;
+        while(payload >= 128) {
+            *pos++ = uint8_t(payload | 128);
+            payload >>= 7;
+        }
+        *pos++ = uint8_t(payload);
+    }
+
+    void push(short id) { event(PUSH, id); }
+    void next(short delta) { event(NEXT, delta); }
+    void pop() { event(POP, 0); }
+    void reject(short cause) { event(REJECT, cause); }
+    void accept() { event(ACCEPT, 0); }
+    void filtered(short cause) { event(FILTERED, cause); }
+
+    // hands the current chunk over and waits for a free one
+    void rotate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        filled[head] = (int)(pos - (ring.data() + chunkSize*head));
+        head = (head+1) % chunks;
+        ++pending;
+        cv.notify_all();
+        cv.wait(lock, [this]{ return pending < chunks; });
+        pos = ring.data() + chunkSize*head;
+        end = pos + chunkSize;
+    }
+
+    void flushLoop() {
+        while(true) {
+            int chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]{ return pending > 0 || closing; });
+                if(pending == 0) return;
+                chunk = tail;
+            }
+            std::fwrite(ring.data() + chunkSize*chunk, 1, filled[chunk], out);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tail = (tail+1) % chunks;
+                --pending;
+            }
+            cv.notify_all();
+        }
+    }
+
+    void close() {
+        if(!out) return;
+        rotate();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        cv.notify_all();
+        flusher.join();
+        std::fclose(out);
+        out = nullptr;
+    }
+};
+
+// Decodes a trace file, calling f(type, payload) for every event.
+struct TraceReader {
+    TraceHeader header;
+    std::vector<uint8_t> data;
+
+    bool open(const std::string& path) {
+        std::FILE* in = std::fopen(path.c_str(), "rb");
+        if(!in) return false;
+        bool ok = std::fread(&header, sizeof(header), 1, in) == 1 && header.valid();
+        uint8_t buffer[1 << 16];
+        size_t n;
+        while(ok && (n = std::fread(buffer, 1, sizeof(buffer), in)) > 0) data.insert(data.end(), buffer, buffer+n);
+        std::fclose(in);
+        return ok;
+    }
+
+    template<typename F>
+    void replay(F&& f) const {
+        size_t i = 0;
+        while(i < data.size()) {
+            uint8_t tag = data[i++];
+            TraceEvent type = TraceEvent(tag >> 5);
+            uint32_t payload = tag & 31;
+            if(payload == 31) {
+                uint32_t extra = 0;
+                int shift = 0;
+                while(i < data.size()) {
+                    uint8_t b = data[i++];
+                    extra |= uint32_t(b & 127) << shift;
+                    shift += 7;
+                    if(!(b & 128)) break;
+                }
+                payload += extra;
+            }
+            f(type, payload);
+        }
+    }
+};
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "options.h"
+#include "trace.h"
+
+// Rebuilds the search tree from a trace recorded with --trace and reports
+// subtree sizes and reject causes by height, and the largest subtrees that
+// ended without any solution. Filtered siblings count as the one-node rejected
+// subtrees the unbatched search opens for them, so both modes report the same
+// tree ; their ids are not recorded, so they are never listed as prefixes.
+
+struct Frame {
+    short id;
+    long long nodes;
+    long long rejects;
+    bool accepted;
+};
+
+struct Height {
+    long long nodes = 0;
+    long long subtree = 0;
+    long long maxSubtree = 0;
+    std::array<long long, 3> rejects = {0, 0, 0};
+};
+
+struct Prefix {
+    long long nodes;
+    long long rejects;
+    std::vector<short> ids;
+
+    bool operator<(const Prefix& other) const { return nodes > other.nodes; }
+};
+
+struct Replay {
+    int P;
+    int rootHeight;
+    size_t prefixHeight;
+    size_t top;
+    std::vector<Frame> stack;
+    std::vector<Height> heights;
+    std::map<int, long long> conflicts;
+    std::priority_queue<Prefix> hottest;
+    long long events = 0;
+
+    Replay(const TraceHeader& header, size_t prefixHeight, size_t top)
+        : P(header.P), rootHeight(header.rootHeight), prefixHeight(prefixHeight), top(top) {
+        stack.push_back(Frame{-1, 1, 0, false});
+    }
+
+    Height& at(size_t height) {
+        if(heights.size() <= height) heights.resize(height+1);
+        return heights[height];
+    }
+
+    void close() {
+        Frame f = stack.back();
+        stack.pop_back();
+        size_t height = rootHeight + stack.size();
+        Height& h = at(height);
+        h.nodes++;
+        h.subtree += f.nodes;
+        h.maxSubtree = std::max(h.maxSubtree, f.nodes);
+        if(height == prefixHeight && !f.accepted) {
+            Prefix p{f.nodes, f.rejects, {}};
+            for(size_t i = 1; i < stack.size(); ++i) p.ids.push_back(stack[i].id);
+            p.ids.push_back(f.id);
+            hottest.push(p);
+            if(hottest.size() > top) hottest.pop();
+        }
+        if(!stack.empty()) {
+            stack.back().nodes += f.nodes;
+            stack.back().rejects += f.rejects;
+            stack.back().accepted |= f.accepted;
+        }
+    }
+
+    void operator()(TraceEvent type, uint32_t payload) {
+        ++events;
+        switch(type) {
+            case PUSH:
+                stack.push_back(Frame{(short)payload, 1, 0, false});
+                break;
+            case NEXT: {
+                short id = stack.back().id + payload;
+                close();
+                stack.push_back(Frame{id, 1, 0, false});
+                break;
+            }
+            case POP:
+                close();
+                break;
+            case REJECT: {
+                stack.back().rejects++;
+                Height& h = at(rootHeight + stack.size()-1);
+                h.rejects[std::min<uint32_t>(payload, CONFLICT)]++;
+                if(payload >= CONFLICT) conflicts[payload-CONFLICT]++;
+                break;
+            }
+            case ACCEPT:
+                stack.back().accepted = true;
+                break;
+            case FILTERED: {
+                stack.back().nodes++;
+                stack.back().rejects++;
+                Height& h = at(rootHeight + stack.size());
+                h.nodes++;
+                h.subtree++;
+                h.maxSubtree = std::max(h.maxSubtree, 1LL);
+                h.rejects[std::min<uint32_t>(payload, CONFLICT)]++;
+                if(payload >= CONFLICT) conflicts[payload-CONFLICT]++;
+                break;
+            }
+        }
+    }
+
+    // the trace stops without pops when the solver exits on a solution
+    void finish() {
+        while(!stack.empty()) close();
+    }
+
+    std::string prefixString(const std::vector<short>& ids) const {
+        std::string s;
+        for(size_t i = 0; i < ids.size(); ++i) {
+            size_t height = rootHeight + i + 1;
+            s += std::to_string(ids[i]) + ((height % P == 0 && i+1 < ids.size()) ? " | " : " ");
+        }
+        return s;
+    }
+
+    void report() {
+        std::cout << "Events : " << events << '\n';
+        std::cout << std::setw(7) << "height" << std::setw(14) << "nodes"
+                  << std::setw(14) << "mean subtree" << std::setw(14) << "max subtree"
+                  << std::setw(12) << "lead" << std::setw(12) << "lookahead" << std::setw(12) << "conflict" << '\n';
+        for(size_t i = 0; i < heights.size(); ++i) {
+            const Height& h = heights[i];
+            if(h.nodes == 0) continue;
+            std::cout << std::setw(7) << i << std::setw(14) << h.nodes
+                      << std::setw(14) << std::fixed << std::setprecision(1) << (double)h.subtree / h.nodes
+                      << std::setw(14) << h.maxSubtree
+                      << std::setw(12) << h.rejects[LEAD] << std::setw(12) << h.rejects[LOOKAHEAD] << std::setw(12) << h.rejects[CONFLICT] << '\n';
+        }
+
+        std::vector<std::pair<long long, int>> slots;
+        for(const auto& c : conflicts) slots.emplace_back(c.second, c.first);
+        std::sort(slots.rbegin(), slots.rend());
+        std::cout << "\nConflicting cards :\n";
+        for(size_t i = 0; i < std::min<size_t>(top, slots.size()); ++i) {
+            std::cout << "  card " << slots[i].second << " : " << slots[i].first << " rejects\n";
+        }
+
+        std::vector<Prefix> prefixes;
+        while(!hottest.empty()) {
+            prefixes.push_back(hottest.top());
+            hottest.pop();
+        }
+        std::reverse(prefixes.begin(), prefixes.end());
+        std::cout << "\nLargest failing prefixes at height " << prefixHeight << " :\n";
+        for(const Prefix& p : prefixes) {
+            std::cout << "  " << p.nodes << " nodes, " << p.rejects << " rejects : " << prefixString(p.ids) << '\n';
+        }
+    }
+};
+
+int main(int argc, const char* argv[]) {
+    Options options(argc, argv);
+    if(options.positional.size() != 1) {
+        std::cout << "Usage : exe traceFile [--height H] [--top K]\n";
+        return 1;
+    }
+    TraceReader reader;
+    if(!reader.open(options.positional[0])) {
+        std::cout << "Cannot read trace " << options.positional[0] << "\n";
+        return 1;
+    }
+    const TraceHeader& header = reader.header;
+    std::cout << "Solver : " << std::string(header.solver, strnlen(header.solver, sizeof(header.solver)))
+              << ", P = " << header.P << ", root height " << header.rootHeight << '\n';
+    size_t height = options.get("height") ? std::atoi(options.get("height")) : header.rootHeight + 2*header.P;
+    size_t top = options.get("top") ? std::atoi(options.get("top")) : 10;
+    Replay replay(header, height, top);
+    reader.replay(replay);
+    replay.finish();
+    replay.report();
+}